@@ -17,6 +17,14 @@ This plugin removes vertical scratches from digitized films.
 #include <algorithm>
 #include <memory>
 #include <cassert>
+#include <cstring>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <mutex>
+#include <set>
+#include <tuple>
+#include <vector>
 
 constexpr BYTE SD_NULL = 0;
 constexpr BYTE SD_EXTREM = 1;
@@ -57,6 +65,9 @@ struct DeScratchShared {
 
     void DeScratch_pass(const BYTE *VS_RESTRICT srcp, ptrdiff_t src_pitch, const BYTE *VS_RESTRICT bluredp, ptrdiff_t blured_pitch,
         BYTE *VS_RESTRICT destp, ptrdiff_t dest_pitch, int row_sizep, int heightp, int hscale, int mindifp, int asym);
+    void find_candidates(const BYTE *VS_RESTRICT bluredp, ptrdiff_t blured_pitch, int row_sizep, int heightp, int hscale, int mindifp, int asym);
+    void repair_scratches(const BYTE *VS_RESTRICT srcp, ptrdiff_t src_pitch, const BYTE *VS_RESTRICT bluredp, ptrdiff_t blured_pitch,
+        BYTE *VS_RESTRICT destp, ptrdiff_t dest_pitch, int row_sizep, int heightp, int hscale, int mindifp);
     ~DeScratchShared() {
         free(scratchdata);
         free(buf);
@@ -365,12 +376,8 @@ static void remove_scratches_plane(const BYTE *VS_RESTRICT src_data, ptrdiff_t s
 
 }
 
-void DeScratchShared::DeScratch_pass(const BYTE *VS_RESTRICT srcp, ptrdiff_t src_pitch, const BYTE *VS_RESTRICT bluredp, ptrdiff_t blured_pitch,
-    BYTE *VS_RESTRICT destp, ptrdiff_t dest_pitch, int row_sizep, int heightp, int hscale, int mindifp, int asym) {
-
-    if (row_sizep < maxwidth + 3)
-        return;
-
+// detection stage, leaves the candidate map after gaps closing in scratchdata
+void DeScratchShared::find_candidates(const BYTE *VS_RESTRICT bluredp, ptrdiff_t blured_pitch, int row_sizep, int heightp, int hscale, int mindifp, int asym) {
     switch (maxwidth) {
     case 1: get_extrems_plane<1>(bluredp, blured_pitch, row_sizep, heightp, scratchdata, mindifp, asym); break;
     case 3: get_extrems_plane<3>(bluredp, blured_pitch, row_sizep, heightp, scratchdata, mindifp, asym); break;
@@ -399,6 +406,11 @@ void DeScratchShared::DeScratch_pass(const BYTE *VS_RESTRICT srcp, ptrdiff_t src
         }
     }
     close_gaps(scratchdata, row_sizep, heightp, maxgap / hscale);
+}
+
+// tracing and removal stage, consumes the candidate map in scratchdata
+void DeScratchShared::repair_scratches(const BYTE *VS_RESTRICT srcp, ptrdiff_t src_pitch, const BYTE *VS_RESTRICT bluredp, ptrdiff_t blured_pitch,
+    BYTE *VS_RESTRICT destp, ptrdiff_t dest_pitch, int row_sizep, int heightp, int hscale, int mindifp) {
     test_scratches(scratchdata, row_sizep, heightp, maxwidth, minlen / hscale, maxlen / hscale, maxangle);
 
     if (mark) {
@@ -410,6 +422,16 @@ void DeScratchShared::DeScratch_pass(const BYTE *VS_RESTRICT srcp, ptrdiff_t src
     }
 }
 
+void DeScratchShared::DeScratch_pass(const BYTE *VS_RESTRICT srcp, ptrdiff_t src_pitch, const BYTE *VS_RESTRICT bluredp, ptrdiff_t blured_pitch,
+    BYTE *VS_RESTRICT destp, ptrdiff_t dest_pitch, int row_sizep, int heightp, int hscale, int mindifp, int asym) {
+
+    if (row_sizep < maxwidth + 3)
+        return;
+
+    find_candidates(bluredp, blured_pitch, row_sizep, heightp, hscale, mindifp, asym);
+    repair_scratches(srcp, src_pitch, bluredp, blured_pitch, destp, dest_pitch, row_sizep, heightp, hscale, mindifp);
+}
+
 PVideoFrame __stdcall DeScratch::GetFrame(int ndest, IScriptEnvironment *env) {
     PVideoFrame src = child->GetFrame(ndest, env);
     PVideoFrame blured = blured_clip->GetFrame(ndest, env);
@@ -482,23 +504,180 @@ extern "C" __declspec(dllexport) const char *__stdcall AvisynthPluginInit3(IScri
 ////////////////
 // VapourSynth support starts here
 
+// Stage results cache, shared by all instances in a core that share a source clip.
+// Lets parameter tuning skip the blur and candidate search when only the tracing
+// and repair parameters (minlen, maxlen, maxangle, keep, border, mark) change.
+
+constexpr int STAGE_BLURED = -1; // plane value of blurred frame entries
+
+struct StageCacheKey {
+    const VSNode *node;
+    int n;
+    int plane;
+    int blurlen;
+    int mindif;
+    int asym;
+    int maxwidth;
+    int minwidth;
+    int maxgap;
+    int wleft;
+    int wright;
+
+    bool operator<(const StageCacheKey &o) const {
+        return std::tie(node, n, plane, blurlen, mindif, asym, maxwidth, minwidth, maxgap, wleft, wright) <
+            std::tie(o.node, o.n, o.plane, o.blurlen, o.mindif, o.asym, o.maxwidth, o.minwidth, o.maxgap, o.wleft, o.wright);
+    }
+};
+
+struct StageCacheItem {
+    const VSAPI *vsapi = nullptr;
+    const VSFrame *frame = nullptr; // blurred frame
+    std::vector<BYTE> map; // candidate map after gaps closing
+    size_t size = 0;
+
+    ~StageCacheItem() {
+        if (frame)
+            vsapi->freeFrame(frame);
+    }
+};
+
+class StageCache {
+    std::mutex lock;
+    size_t capacity = 0;
+    size_t used = 0;
+    std::list<StageCacheKey> lru; // most recently used first
+    std::map<StageCacheKey, std::pair<std::shared_ptr<const StageCacheItem>, std::list<StageCacheKey>::iterator>> entries;
+    std::map<const VSNode *, int> users;
+    std::multiset<size_t> capacities; // one per live user, the largest one applies
+
+    void evict(std::map<StageCacheKey, std::pair<std::shared_ptr<const StageCacheItem>, std::list<StageCacheKey>::iterator>>::iterator it) {
+        used -= it->second.first->size;
+        lru.erase(it->second.second);
+        entries.erase(it);
+    }
+
+public:
+    void addUser(const VSNode *node, size_t size) {
+        std::lock_guard<std::mutex> guard(lock);
+        users[node]++;
+        capacities.insert(size);
+        capacity = *capacities.rbegin();
+    }
+
+    // returns true when the last user is gone
+    bool removeUser(const VSNode *node, size_t size) {
+        std::lock_guard<std::mutex> guard(lock);
+        capacities.erase(capacities.find(size));
+        capacity = capacities.empty() ? 0 : *capacities.rbegin();
+        if (--users[node] == 0) {
+            users.erase(node);
+            // entries can't outlive the node, its address may be reused
+            for (auto it = entries.begin(); it != entries.end();) {
+                auto next = std::next(it);
+                if (it->first.node == node)
+                    evict(it);
+                it = next;
+            }
+        }
+        while (used > capacity)
+            evict(entries.find(lru.back()));
+        return users.empty();
+    }
+
+    std::shared_ptr<const StageCacheItem> find(const StageCacheKey &key) {
+        std::lock_guard<std::mutex> guard(lock);
+        auto it = entries.find(key);
+        if (it == entries.end())
+            return nullptr;
+        lru.splice(lru.begin(), lru, it->second.second);
+        return it->second.first;
+    }
+
+    void insert(const StageCacheKey &key, std::shared_ptr<const StageCacheItem> item) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (item->size > capacity)
+            return;
+        auto it = entries.find(key);
+        if (it != entries.end())
+            evict(it);
+        while (used + item->size > capacity)
+            evict(entries.find(lru.back()));
+        lru.push_front(key);
+        used += item->size;
+        entries.emplace(key, std::make_pair(std::move(item), lru.begin()));
+    }
+};
+
+static std::mutex stageCachesLock;
+static std::map<const VSCore *, std::shared_ptr<StageCache>> stageCaches;
+
 struct DeScratchVSData : public DeScratchShared {
     VSNode *node;
     VSNode *blured_clip;
+    std::shared_ptr<StageCache> cache;
+    size_t cache_size;
+
+    void DeScratch_cached_pass(int n, int plane, const BYTE *VS_RESTRICT srcp, ptrdiff_t src_pitch, const BYTE *VS_RESTRICT bluredp, ptrdiff_t blured_pitch,
+        BYTE *VS_RESTRICT destp, ptrdiff_t dest_pitch, int row_sizep, int heightp, int hscale, int mindifp);
 };
 
+void DeScratchVSData::DeScratch_cached_pass(int n, int plane, const BYTE *VS_RESTRICT srcp, ptrdiff_t src_pitch, const BYTE *VS_RESTRICT bluredp, ptrdiff_t blured_pitch,
+    BYTE *VS_RESTRICT destp, ptrdiff_t dest_pitch, int row_sizep, int heightp, int hscale, int mindifp) {
+
+    if (!cache) {
+        DeScratch_pass(srcp, src_pitch, bluredp, blured_pitch, destp, dest_pitch, row_sizep, heightp, hscale, mindifp, asym);
+        return;
+    }
+
+    if (row_sizep < maxwidth + 3)
+        return;
+
+    StageCacheKey key{ node, n, plane, blurlen, mindifp, asym, maxwidth, minwidth, maxgap, wleft, wright };
+    std::shared_ptr<const StageCacheItem> item = cache->find(key);
+    if (item) {
+        memcpy(scratchdata, item->map.data(), item->map.size());
+    } else {
+        find_candidates(bluredp, blured_pitch, row_sizep, heightp, hscale, mindifp, asym);
+        auto newitem = std::make_shared<StageCacheItem>();
+        newitem->map.assign(scratchdata, scratchdata + row_sizep * heightp);
+        newitem->size = newitem->map.size();
+        cache->insert(key, std::move(newitem));
+    }
+    repair_scratches(srcp, src_pitch, bluredp, blured_pitch, destp, dest_pitch, row_sizep, heightp, hscale, mindifp);
+}
+
 static const VSFrame *VS_CC deScratchGetFrame(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
     DeScratchVSData *d = (DeScratchVSData *)instanceData;
 
     if (activationReason == arInitial) {
         vsapi->requestFrameFilter(n, d->node, frameCtx);
-        vsapi->requestFrameFilter(n, d->blured_clip, frameCtx);
+        std::shared_ptr<const StageCacheItem> blured_item;
+        if (d->cache)
+            blured_item = d->cache->find(StageCacheKey{ d->node, n, STAGE_BLURED, d->blurlen, 0, 0, 0, 0, 0, 0, 0 });
+        if (blured_item)
+            *frameData = new std::shared_ptr<const StageCacheItem>(std::move(blured_item)); // keep it alive until the frame is done
+        else
+            vsapi->requestFrameFilter(n, d->blured_clip, frameCtx);
     } else if (activationReason == arAllFramesReady) {
+        std::unique_ptr<std::shared_ptr<const StageCacheItem>> blured_item(static_cast<std::shared_ptr<const StageCacheItem> *>(*frameData));
         const VSFrame *src = vsapi->getFrameFilter(n, d->node, frameCtx);
-        const VSFrame *blured = vsapi->getFrameFilter(n, d->blured_clip, frameCtx);
+        const VSFrame *blured;
+        if (blured_item) {
+            blured = vsapi->addFrameRef((*blured_item)->frame);
+        } else {
+            blured = vsapi->getFrameFilter(n, d->blured_clip, frameCtx);
+            if (d->cache) {
+                auto newitem = std::make_shared<StageCacheItem>();
+                newitem->vsapi = vsapi;
+                newitem->frame = vsapi->addFrameRef(blured);
+                for (int plane = 0; plane < 3; plane++)
+                    newitem->size += vsapi->getStride(blured, plane) * vsapi->getFrameHeight(blured, plane);
+                d->cache->insert(StageCacheKey{ d->node, n, STAGE_BLURED, d->blurlen, 0, 0, 0, 0, 0, 0, 0 }, std::move(newitem));
+            }
+        }
         VSFrame *dest = vsapi->newVideoFrame(vsapi->getVideoFrameFormat(src), d->width, d->height, src, core);
 
-        auto ProcessPlane = [src, blured, dest, vsapi, d](int plane, int mode, int mindif) {
+        auto ProcessPlane = [n, src, blured, dest, vsapi, d](int plane, int mode, int mindif) {
             const BYTE *bluredp = vsapi->getReadPtr(blured, plane);
             ptrdiff_t blured_pitch = vsapi->getStride(blured, plane);
             BYTE *destp = vsapi->getWritePtr(dest, plane);
@@ -512,14 +691,14 @@ static const VSFrame *VS_CC deScratchGetFrame(int n, int activationReason, void
 
             if (mode == MODE_ALL) {
                 vsh::bitblt(d->buf, d->buf_pitch, srcp, src_pitch, row_size, heightp);
-                d->DeScratch_pass(srcp + wleftp, src_pitch, bluredp + wleftp, blured_pitch, d->buf + wleftp, d->buf_pitch, wrightp - wleftp, heightp, d->height / heightp, mindif, d->asym);
+                d->DeScratch_cached_pass(n, plane, srcp + wleftp, src_pitch, bluredp + wleftp, blured_pitch, d->buf + wleftp, d->buf_pitch, wrightp - wleftp, heightp, d->height / heightp, mindif);
                 vsh::bitblt(destp, dest_pitch, d->buf, d->buf_pitch, row_size, heightp);
-                d->DeScratch_pass(d->buf + wleftp, d->buf_pitch, bluredp + wleftp, blured_pitch, destp + wleftp, dest_pitch, wrightp - wleftp, heightp, (d->height / heightp), (-mindif), d->asym);
+                d->DeScratch_cached_pass(n, plane, d->buf + wleftp, d->buf_pitch, bluredp + wleftp, blured_pitch, destp + wleftp, dest_pitch, wrightp - wleftp, heightp, (d->height / heightp), (-mindif));
             } else {
                 vsh::bitblt(destp, dest_pitch, srcp, src_pitch, row_size, heightp);
                 if (mode == MODE_LOW || mode == MODE_HIGH) {
                     int sign = (mode == MODE_LOW) ? 1 : -1;
-                    d->DeScratch_pass(srcp + wleftp, src_pitch, bluredp + wleftp, blured_pitch, destp + wleftp, dest_pitch, wrightp - wleftp, heightp, d->height / heightp, sign * mindif, d->asym);
+                    d->DeScratch_cached_pass(n, plane, srcp + wleftp, src_pitch, bluredp + wleftp, blured_pitch, destp + wleftp, dest_pitch, wrightp - wleftp, heightp, d->height / heightp, sign * mindif);
                 }
             }
             };
@@ -532,6 +711,8 @@ static const VSFrame *VS_CC deScratchGetFrame(int n, int activationReason, void
         vsapi->freeFrame(blured);
 
         return dest;
+    } else if (activationReason == arError) {
+        delete static_cast<std::shared_ptr<const StageCacheItem> *>(*frameData);
     }
 
     return nullptr;
@@ -539,6 +720,11 @@ static const VSFrame *VS_CC deScratchGetFrame(int n, int activationReason, void
 
 static void VS_CC deScratchFree(void *instanceData, VSCore *core, const VSAPI *vsapi) {
     DeScratchVSData *d = (DeScratchVSData *)instanceData;
+    if (d->cache) {
+        std::lock_guard<std::mutex> guard(stageCachesLock);
+        if (d->cache->removeUser(d->node, d->cache_size))
+            stageCaches.erase(core);
+    }
     vsapi->freeNode(d->node);
     vsapi->freeNode(d->blured_clip);
     delete d;
@@ -593,6 +779,7 @@ static void VS_CC deScratchCreate(const VSMap *in, VSMap *out, void *userData, V
     d->wright = vsapi->mapGetIntSaturated(in, "right", 0, &err);
     if (err)
         d->wright = 4096;
+    int cachesize = vsapi->mapGetIntSaturated(in, "cache", 0, &err);
 
     if (d->mindif <= 0)
         RETERROR("Descratch: mindif must be positive!");
@@ -624,6 +811,8 @@ static void VS_CC deScratchCreate(const VSMap *in, VSMap *out, void *userData, V
         RETERROR("Descratch: minwidth must be not above maxwidth!");
     if (!(d->minwidth % 2) || (d->minwidth < 1) || (d->minwidth > 15))
         RETERROR("Descratch: minwidth must be odd from 1 to 15!"); // v.1.0
+    if (cachesize < 0)
+        RETERROR("Descratch: cache must be not negative!");
 
     d->node = vsapi->mapGetNode(in, "clip", 0, nullptr);
     const VSVideoInfo *vi = vsapi->getVideoInfo(d->node);
@@ -668,6 +857,16 @@ static void VS_CC deScratchCreate(const VSMap *in, VSMap *out, void *userData, V
     d->scratchdata = (BYTE *)malloc(vi->height * vi->width);
     d->buf = (BYTE *)malloc(d->height * d->buf_pitch);
 
+    if (cachesize > 0) {
+        std::lock_guard<std::mutex> guard(stageCachesLock);
+        std::shared_ptr<StageCache> &cache = stageCaches[core];
+        if (!cache)
+            cache = std::make_shared<StageCache>();
+        d->cache_size = static_cast<size_t>(std::min<uint64_t>(static_cast<uint64_t>(cachesize) << 20, SIZE_MAX));
+        cache->addUser(d->node, d->cache_size);
+        d->cache = cache;
+    }
+
     VSFilterDependency deps[] = { {d->node, rpStrictSpatial}, {d->blured_clip, rpStrictSpatial} }; /* Depending the the request patterns you may want to change this */
     vsapi->createVideoFilter(out, "DeScratch", vi, deScratchGetFrame, deScratchFree, fmParallelRequests, deps, 2, d.release(), core);
 }
@@ -677,5 +876,5 @@ static void VS_CC deScratchCreate(const VSMap *in, VSMap *out, void *userData, V
 
 VS_EXTERNAL_API(void) VapourSynthPluginInit2(VSPlugin *plugin, const VSPLUGINAPI *vspapi) {
     vspapi->configPlugin("com.vapoursynth.descratch", "descratch", "DeScratch for Vapoursynth and friends", VS_MAKE_VERSION(3, 0), VAPOURSYNTH_API_VERSION, 0, plugin);
-    vspapi->registerFunction("DeScratch", "clip:vnode;mindif:int:opt;asym:int:opt;maxgap:int:opt;maxwidth:int:opt;minlen:int:opt;maxlen:int:opt;maxangle:float:opt;blurlen:int:opt;keep:int:opt;border:int:opt;modey:int:opt;modeu:int:opt;modev:int:opt;mindifuv:int:opt;mark:int:opt;minwidth:int:opt;left:int:opt;right:int:opt;", "clip:vnode;", deScratchCreate, nullptr, plugin);
+    vspapi->registerFunction("DeScratch", "clip:vnode;mindif:int:opt;asym:int:opt;maxgap:int:opt;maxwidth:int:opt;minlen:int:opt;maxlen:int:opt;maxangle:float:opt;blurlen:int:opt;keep:int:opt;border:int:opt;modey:int:opt;modeu:int:opt;modev:int:opt;mindifuv:int:opt;mark:int:opt;minwidth:int:opt;left:int:opt;right:int:opt;cache:int:opt;", "clip:vnode;", deScratchCreate, nullptr, plugin);
 }
\ No newline at end of file
@@ -0,0 +1,562 @@
+/*
+DeScratch regression tests
+
+Runs the plugin code against the frozen scalar kernels in reference.h and
+requires bit-exact scratch maps and output planes over the parameter grid:
+every maxwidth/minwidth pair, both polarities, MODE_ALL, mark, left/right
+windows and YV12/YV16/YV24, on synthetic scratched planes and random planes.
+The VapourSynth filter is driven through a minimal fake VSAPI, with and
+without the stage results cache.
+
+With --bench it measures per-configuration throughput of the plugin passes
+against the reference instead, and fails if the plugin is more than twice
+as slow as the reference in the same run.
+*/
+
+#include "../src/descratch.cpp"
+#include "reference.h"
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <string>
+
+static int failures = 0;
+static long checks = 0;
+
+static void check(bool ok, const std::string &what) {
+    checks++;
+    if (!ok) {
+        failures++;
+        if (failures <= 20)
+            fprintf(stderr, "FAIL: %s\n", what.c_str());
+    }
+}
+
+////////////////
+// Test planes
+
+struct Plane {
+    int width;
+    int height;
+    ptrdiff_t pitch;
+    std::vector<BYTE> data;
+
+    Plane(int w, int h) : width(w), height(h), pitch((w + 31) & ~31), data(pitch * h, 0xAA) {}
+    BYTE *ptr() { return data.data(); }
+    const BYTE *ptr() const { return data.data(); }
+    BYTE &at(int x, int y) { return data[y * pitch + x]; }
+
+    bool same(const Plane &o) const {
+        for (int y = 0; y < height; y++)
+            if (!std::equal(ptr() + y * pitch, ptr() + y * pitch + width, o.ptr() + y * o.pitch))
+                return false;
+        return true;
+    }
+};
+
+// gradient background with slanted, gapped, dark and bright scratches of various widths
+static void fill_synthetic(Plane &p, uint32_t seed) {
+    std::mt19937 rng(seed);
+    for (int y = 0; y < p.height; y++)
+        for (int x = 0; x < p.width; x++)
+            p.at(x, y) = 100 + (x * 3 + y) % 40 + rng() % 6;
+    for (int s = 0; s < p.width / 12; s++) {
+        int x0 = 10 + rng() % (p.width - 20);
+        int w = 1 + rng() % 9;
+        int amp = 15 + rng() % 40;
+        int y0 = rng() % (p.height / 3);
+        int y1 = y0 + p.height / 3 + rng() % (p.height / 2);
+        bool dark = s & 1;
+        float slope = (static_cast<int>(rng() % 5) - 2) / 100.f;
+        for (int y = y0; y < std::min(y1, p.height); y++) {
+            if (rng() % 30 == 0)
+                continue;
+            int xc = x0 + static_cast<int>(slope * (y - y0));
+            for (int x = std::max(xc, 0); x < xc + w && x < p.width; x++)
+                p.at(x, y) = dark ? std::max(0, p.at(x, y) - amp) : std::min(255, p.at(x, y) + amp);
+        }
+    }
+}
+
+static void fill_random(Plane &p, uint32_t seed) {
+    std::mt19937 rng(seed);
+    for (int y = 0; y < p.height; y++)
+        for (int x = 0; x < p.width; x++)
+            p.at(x, y) = rng() & 255;
+}
+
+// vertical box blur, stands in for the resize chain of the filters
+static Plane blur_plane(const Plane &s, int radius) {
+    Plane b(s.width, s.height);
+    for (int y = 0; y < s.height; y++) {
+        for (int x = 0; x < s.width; x++) {
+            int sum = 0, cnt = 0;
+            for (int k = std::max(0, y - radius); k <= std::min(s.height - 1, y + radius); k++) {
+                sum += s.data[k * s.pitch + x];
+                cnt++;
+            }
+            b.at(x, y) = sum / cnt;
+        }
+    }
+    return b;
+}
+
+////////////////
+// Kernel tests, plugin passes against the reference on single planes
+
+static reference::Params to_reference(const DeScratchShared &s) {
+    return { s.mindif, s.asym, s.maxgap, s.maxwidth, s.minlen, s.maxlen, s.maxangle, s.keep, s.border, s.mark, s.minwidth };
+}
+
+static long test_kernels() {
+    long good = 0;
+    const int width = 176;
+
+    for (int kind = 0; kind < 2; kind++) {
+        for (int hscale = 1; hscale <= 2; hscale++) {
+            Plane src(width, 144 / hscale);
+            if (kind == 0)
+                fill_synthetic(src, 1000 + hscale);
+            else
+                fill_random(src, 2000 + hscale);
+            Plane blured = blur_plane(src, 4);
+
+            for (int maxwidth = 1; maxwidth <= 15; maxwidth += 2) {
+                for (int minwidth = 1; minwidth <= maxwidth; minwidth += 2) {
+                    for (int sign = -1; sign <= 1; sign += 2) {
+                        for (int mark = 0; mark <= 1; mark++) {
+                            for (int maxgap : { 0, 5 }) {
+                                std::string cfg = std::string(kind ? "random" : "synthetic") + " hscale=" + std::to_string(hscale) +
+                                    " maxwidth=" + std::to_string(maxwidth) + " minwidth=" + std::to_string(minwidth) +
+                                    " sign=" + std::to_string(sign) + " mark=" + std::to_string(mark) + " maxgap=" + std::to_string(maxgap);
+
+                                DeScratchShared s{};
+                                s.mindif = 3;
+                                s.asym = 10;
+                                s.maxgap = maxgap;
+                                s.maxwidth = maxwidth;
+                                s.minlen = 20;
+                                s.maxlen = 2048;
+                                s.maxangle = 5.0f;
+                                s.keep = 60;
+                                s.border = 2;
+                                s.mark = !!mark;
+                                s.minwidth = minwidth;
+                                s.scratchdata = (BYTE *)malloc(src.width * src.height);
+                                reference::Params p = to_reference(s);
+                                std::vector<BYTE> d(src.width * src.height);
+
+                                s.find_candidates(blured.ptr(), blured.pitch, src.width, src.height, hscale, sign * s.mindif, s.asym);
+                                reference::find_candidates(p, blured.ptr(), blured.pitch, src.width, src.height, hscale, sign * s.mindif, d.data());
+                                check(std::equal(d.begin(), d.end(), s.scratchdata), "candidate map " + cfg);
+
+                                Plane dest = src, ref_dest = src;
+                                s.DeScratch_pass(src.ptr(), src.pitch, blured.ptr(), blured.pitch, dest.ptr(), dest.pitch, src.width, src.height, hscale, sign * s.mindif, s.asym);
+                                reference::pass(p, src.ptr(), src.pitch, blured.ptr(), blured.pitch, ref_dest.ptr(), ref_dest.pitch, src.width, src.height, hscale, sign * s.mindif, d.data());
+                                check(std::equal(d.begin(), d.end(), s.scratchdata), "scratch map " + cfg);
+                                check(dest.same(ref_dest), "output plane " + cfg);
+
+                                good += std::count(d.begin(), d.end(), reference::SD_GOOD);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return good;
+}
+
+////////////////
+// Minimal fake VSAPI, enough to drive the VapourSynth filter
+
+struct VSFrame {
+    VSVideoFormat format;
+    Plane *planes[3];
+    int refs = 1;
+};
+
+struct VSNode {
+    VSVideoInfo vi;
+    VSNode *src; // set for the blurred clip
+    int radius;
+    bool random;
+};
+
+struct VSMap {
+    std::map<std::string, int64_t> ints;
+    std::map<std::string, VSNode *> nodes;
+    std::string error;
+};
+
+struct VSCore {};
+struct VSPlugin {};
+struct VSFrameContext {};
+
+static int blur_requests = 0;
+static int live_frames = 0;
+static void *filter_instance;
+static VSFilterGetFrame filter_getframe;
+static VSFilterFree filter_free;
+static std::vector<VSNode *> blured_nodes;
+
+static VSFrame *alloc_frame(const VSVideoFormat &f, int width, int height) {
+    VSFrame *frame = new VSFrame{ f, {} };
+    for (int plane = 0; plane < 3; plane++)
+        frame->planes[plane] = new Plane(plane ? width >> f.subSamplingW : width, plane ? height >> f.subSamplingH : height);
+    live_frames++;
+    return frame;
+}
+
+static VSFrame *source_frame(const VSNode *node, int n) {
+    VSFrame *frame = alloc_frame(node->vi.format, node->vi.width, node->vi.height);
+    for (int plane = 0; plane < 3; plane++) {
+        if (node->random)
+            fill_random(*frame->planes[plane], n * 3 + plane);
+        else
+            fill_synthetic(*frame->planes[plane], n * 3 + plane);
+    }
+    return frame;
+}
+
+static const VSFrame *VS_CC fakeAddFrameRef(const VSFrame *f) {
+    const_cast<VSFrame *>(f)->refs++;
+    return f;
+}
+
+static void VS_CC fakeFreeFrame(const VSFrame *f) {
+    if (f && --const_cast<VSFrame *>(f)->refs == 0) {
+        for (Plane *p : f->planes)
+            delete p;
+        delete f;
+        live_frames--;
+    }
+}
+
+static const VSFrame *VS_CC fakeGetFrameFilter(int n, VSNode *node, VSFrameContext *frameCtx) {
+    if (!node->src)
+        return source_frame(node, n);
+    VSFrame *src = source_frame(node->src, n);
+    VSFrame *blured = alloc_frame(src->format, node->vi.width, node->vi.height);
+    for (int plane = 0; plane < 3; plane++)
+        *blured->planes[plane] = blur_plane(*src->planes[plane], node->radius);
+    fakeFreeFrame(src);
+    return blured;
+}
+
+static void VS_CC fakeRequestFrameFilter(int n, VSNode *node, VSFrameContext *frameCtx) {
+    if (node->src)
+        blur_requests++;
+}
+
+static VSFrame *VS_CC fakeNewVideoFrame(const VSVideoFormat *format, int width, int height, const VSFrame *propSrc, VSCore *core) {
+    return alloc_frame(*format, width, height);
+}
+
+static const VSVideoFormat *VS_CC fakeGetVideoFrameFormat(const VSFrame *f) { return &f->format; }
+static const uint8_t *VS_CC fakeGetReadPtr(const VSFrame *f, int plane) { return f->planes[plane]->ptr(); }
+static uint8_t *VS_CC fakeGetWritePtr(VSFrame *f, int plane) { return f->planes[plane]->ptr(); }
+static ptrdiff_t VS_CC fakeGetStride(const VSFrame *f, int plane) { return f->planes[plane]->pitch; }
+static int VS_CC fakeGetFrameWidth(const VSFrame *f, int plane) { return f->planes[plane]->width; }
+static int VS_CC fakeGetFrameHeight(const VSFrame *f, int plane) { return f->planes[plane]->height; }
+static void VS_CC fakeFreeNode(VSNode *node) {}
+static const VSVideoInfo *VS_CC fakeGetVideoInfo(VSNode *node) { return &node->vi; }
+static VSMap *VS_CC fakeCreateMap(void) { return new VSMap; }
+static void VS_CC fakeFreeMap(VSMap *map) { delete map; }
+static void VS_CC fakeMapSetError(VSMap *map, const char *errorMessage) { map->error = errorMessage; }
+
+static int VS_CC fakeMapGetIntSaturated(const VSMap *map, const char *key, int index, int *error) {
+    auto it = map->ints.find(key);
+    *error = it == map->ints.end();
+    return *error ? 0 : static_cast<int>(it->second);
+}
+
+static float VS_CC fakeMapGetFloatSaturated(const VSMap *map, const char *key, int index, int *error) {
+    *error = 1;
+    return 0;
+}
+
+static VSNode *VS_CC fakeMapGetNode(const VSMap *map, const char *key, int index, int *error) { return map->nodes.at(key); }
+
+static int VS_CC fakeMapSetNode(VSMap *map, const char *key, VSNode *node, int append) {
+    map->nodes[key] = node;
+    return 0;
+}
+
+static int VS_CC fakeMapSetInt(VSMap *map, const char *key, int64_t i, int append) {
+    map->ints[key] = i;
+    return 0;
+}
+
+static uint32_t VS_CC fakeQueryVideoFormatID(int colorFamily, int sampleType, int bitsPerSample, int subSamplingW, int subSamplingH, VSCore *core) {
+    if (subSamplingW == 1 && subSamplingH == 1)
+        return pfYUV420P8;
+    if (subSamplingW == 1 && subSamplingH == 0)
+        return pfYUV422P8;
+    return pfYUV444P8;
+}
+
+static VSPlugin *VS_CC fakeGetPluginByID(const char *identifier, VSCore *core) {
+    static VSPlugin plugin;
+    return &plugin;
+}
+
+// the downscale does nothing, the upscale returns the box blurred source with a radius from the downscaled height
+static VSMap *VS_CC fakeInvoke(VSPlugin *plugin, const char *name, const VSMap *args) {
+    VSMap *out = new VSMap(*args);
+    if (std::string(name) == "Bilinear") {
+        out->ints["down_height"] = args->ints.at("height");
+    } else {
+        VSNode *src = args->nodes.at("clip");
+        int radius = static_cast<int>(src->vi.height / std::max<int64_t>(args->ints.at("down_height"), 1) / 2);
+        out->nodes["clip"] = new VSNode{ src->vi, src, radius, false };
+    }
+    return out;
+}
+
+static void VS_CC fakeCreateVideoFilter(VSMap *out, const char *name, const VSVideoInfo *vi, VSFilterGetFrame getFrame, VSFilterFree free,
+    int filterMode, const VSFilterDependency *dependencies, int numDeps, void *instanceData, VSCore *core) {
+    filter_instance = instanceData;
+    filter_getframe = getFrame;
+    filter_free = free;
+    // the fake blurred node is owned by the test from here on
+    blured_nodes.push_back(dependencies[1].source);
+}
+
+static VSAPI make_api() {
+    VSAPI api{};
+    api.createVideoFilter = fakeCreateVideoFilter;
+    api.freeNode = fakeFreeNode;
+    api.addFrameRef = fakeAddFrameRef;
+    api.freeFrame = fakeFreeFrame;
+    api.newVideoFrame = fakeNewVideoFrame;
+    api.getStride = fakeGetStride;
+    api.getReadPtr = fakeGetReadPtr;
+    api.getWritePtr = fakeGetWritePtr;
+    api.getVideoFrameFormat = fakeGetVideoFrameFormat;
+    api.getFrameWidth = fakeGetFrameWidth;
+    api.getFrameHeight = fakeGetFrameHeight;
+    api.getVideoInfo = fakeGetVideoInfo;
+    api.queryVideoFormatID = fakeQueryVideoFormatID;
+    api.createMap = fakeCreateMap;
+    api.freeMap = fakeFreeMap;
+    api.mapSetError = fakeMapSetError;
+    api.mapGetIntSaturated = fakeMapGetIntSaturated;
+    api.mapGetFloatSaturated = fakeMapGetFloatSaturated;
+    api.mapSetInt = fakeMapSetInt;
+    api.mapGetNode = fakeMapGetNode;
+    api.mapSetNode = fakeMapSetNode;
+    api.getPluginByID = fakeGetPluginByID;
+    api.invoke = fakeInvoke;
+    api.requestFrameFilter = fakeRequestFrameFilter;
+    api.getFrameFilter = fakeGetFrameFilter;
+    return api;
+}
+
+static const VSAPI api = make_api();
+static VSCore core;
+
+typedef std::map<std::string, int64_t> Args;
+
+static void *create_filter(VSNode *src, const Args &args) {
+    VSMap in, out;
+    in.nodes["clip"] = src;
+    in.ints = args;
+    filter_instance = nullptr;
+    deScratchCreate(&in, &out, nullptr, &core, &api);
+    check(out.error.empty(), "filter creation " + out.error);
+    return filter_instance;
+}
+
+static VSFrame *filter_frame(void *instance, int n) {
+    void *frameData = nullptr;
+    VSFrameContext ctx;
+    filter_getframe(n, arInitial, instance, &frameData, &ctx, &core, &api);
+    return const_cast<VSFrame *>(filter_getframe(n, arAllFramesReady, instance, &frameData, &ctx, &core, &api));
+}
+
+static int arg(const Args &args, const char *key, int def) {
+    auto it = args.find(key);
+    return it == args.end() ? def : static_cast<int>(it->second);
+}
+
+// whole frame through the reference kernels, with the argument defaults and checks of the filters
+static VSFrame *reference_frame(VSNode *src, const Args &args, int n) {
+    reference::Params p{ arg(args, "mindif", 5), arg(args, "asym", 10), arg(args, "maxgap", 2), arg(args, "maxwidth", 3),
+        arg(args, "minlen", 100), arg(args, "maxlen", 2048), 5.0f, arg(args, "keep", 100), arg(args, "border", 2),
+        !!arg(args, "mark", 0), arg(args, "minwidth", 1) };
+    int blurlen = arg(args, "blurlen", 15);
+    int mindifuv = arg(args, "mindifuv", 0);
+    if (mindifuv == 0)
+        mindifuv = p.mindif;
+    int width = src->vi.width;
+    int height = src->vi.height;
+    int wleft = std::max(arg(args, "left", 0), 0);
+    wleft -= wleft % 2;
+    int wright = std::min(arg(args, "right", 4096), width);
+    wright -= wright % 2;
+    int down_height = height / (1 + blurlen);
+    if (down_height % 2)
+        down_height -= 1;
+
+    VSFrame *s = source_frame(src, n);
+    VSFrame *dest = alloc_frame(src->vi.format, width, height);
+    int modes[3] = { arg(args, "modey", 1), arg(args, "modeu", 0), arg(args, "modev", 0) };
+    for (int plane = 0; plane < 3; plane++) {
+        Plane &sp = *s->planes[plane];
+        Plane blured = blur_plane(sp, height / std::max(down_height, 1) / 2);
+        reference::process_plane(p, sp.ptr(), sp.pitch, blured.ptr(), blured.pitch, dest->planes[plane]->ptr(), dest->planes[plane]->pitch,
+            sp.width, sp.height, width, height, modes[plane], plane ? mindifuv : p.mindif, wleft, wright);
+    }
+    fakeFreeFrame(s);
+    return dest;
+}
+
+static bool same_frame(const VSFrame *a, const VSFrame *b) {
+    for (int plane = 0; plane < 3; plane++)
+        if (!a->planes[plane]->same(*b->planes[plane]))
+            return false;
+    return true;
+}
+
+static void test_filter() {
+    const struct { int ssw, ssh; const char *name; } formats[] = { { 1, 1, "420" }, { 1, 0, "422" }, { 0, 0, "444" } };
+    const Args configs[] = {
+        { { "modey", 3 }, { "modeu", 1 }, { "modev", 2 }, { "mindif", 3 }, { "minlen", 20 } },
+        { { "modey", 3 }, { "modeu", 3 }, { "modev", 3 }, { "mindif", 3 }, { "minlen", 20 }, { "left", 61 }, { "right", 251 }, { "mark", 1 } },
+        { { "modey", 1 }, { "modeu", 2 }, { "mindif", 4 }, { "minlen", 30 }, { "maxwidth", 5 }, { "minwidth", 3 }, { "maxgap", 8 }, { "left", 31 }, { "right", 201 } },
+        { { "modey", 2 }, { "modev", 1 }, { "mindif", 3 }, { "mindifuv", 6 }, { "minlen", 10 }, { "maxwidth", 7 }, { "mark", 1 }, { "asym", 20 }, { "blurlen", 7 } },
+    };
+    // only the tracing and repair parameters change, as when tuning in a previewer
+    const Args tweaks[] = { {}, { { "minlen", 60 }, { "keep", 40 }, { "border", 0 } }, { { "maxlen", 100 }, { "mark", 1 } }, { { "mark", 0 }, { "keep", 0 } } };
+
+    long changed = 0;
+
+    for (int cache : { 0, 64, 1 }) {
+        for (const auto &format : formats) {
+            for (int random = 0; random <= 1; random++) {
+                for (const Args &config : configs) {
+                    VSNode *src = new VSNode{};
+                    src->vi.format.colorFamily = cfYUV;
+                    src->vi.format.sampleType = stInteger;
+                    src->vi.format.bitsPerSample = 8;
+                    src->vi.format.bytesPerSample = 1;
+                    src->vi.format.subSamplingW = format.ssw;
+                    src->vi.format.subSamplingH = format.ssh;
+                    src->vi.format.numPlanes = 3;
+                    src->vi.width = 320;
+                    src->vi.height = 240;
+                    src->vi.numFrames = 3;
+                    src->random = !!random;
+                    std::vector<void *> instances;
+
+                    for (int pass = 0; pass < 2; pass++) {
+                        for (const Args &tweak : tweaks) {
+                            Args args = config;
+                            for (const auto &kv : tweak)
+                                args[kv.first] = kv.second;
+                            args["cache"] = cache;
+                            void *instance = create_filter(src, args);
+                            if (!instance)
+                                continue;
+                            instances.push_back(instance);
+
+                            for (int n = 0; n < src->vi.numFrames; n++) {
+                                std::string cfg = std::string("filter ") + format.name + (random ? " random" : " synthetic") +
+                                    " cache=" + std::to_string(cache) + " pass=" + std::to_string(pass) + " frame=" + std::to_string(n);
+                                int requests = blur_requests;
+                                VSFrame *out = filter_frame(instance, n);
+                                VSFrame *ref = reference_frame(src, args, n);
+                                check(same_frame(out, ref), "output frame " + cfg);
+                                VSFrame *s = source_frame(src, n);
+                                changed += !same_frame(out, s);
+                                fakeFreeFrame(s);
+                                if (cache == 64 && (pass > 0 || &tweak != &tweaks[0]))
+                                    check(blur_requests == requests, "blurred frame served from cache " + cfg);
+                                fakeFreeFrame(out);
+                                fakeFreeFrame(ref);
+                            }
+                        }
+                    }
+
+                    for (void *instance : instances)
+                        filter_free(instance, &core, &api);
+                    check(stageCaches.empty(), "stage cache released");
+                    delete src;
+                }
+            }
+        }
+    }
+
+    check(changed > 0, "filter changes frames");
+    for (VSNode *node : blured_nodes)
+        delete node;
+    blured_nodes.clear();
+    check(live_frames == 0, "all frames freed");
+}
+
+////////////////
+// Throughput
+
+static double best_time(const std::function<void()> &f) {
+    double best = 1e30;
+    for (int i = 0; i < 5; i++) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+static void bench() {
+    Plane src(1920, 1080);
+    fill_synthetic(src, 42);
+    Plane blured = blur_plane(src, 8);
+    Plane dest = src;
+    std::vector<BYTE> d(src.width * src.height);
+    double mpix = src.width * src.height / 1e6;
+
+    for (int maxwidth : { 1, 3, 7, 15 }) {
+        for (int mark = 0; mark <= 1; mark++) {
+            DeScratchShared s{};
+            s.mindif = 3;
+            s.asym = 10;
+            s.maxgap = 3;
+            s.maxwidth = maxwidth;
+            s.minlen = 100;
+            s.maxlen = 2048;
+            s.maxangle = 5.0f;
+            s.keep = 100;
+            s.border = 2;
+            s.mark = !!mark;
+            s.minwidth = 1;
+            s.scratchdata = (BYTE *)malloc(src.width * src.height);
+            reference::Params p = to_reference(s);
+
+            double tr = best_time([&] {
+                for (int sign = -1; sign <= 1; sign += 2)
+                    reference::pass(p, src.ptr(), src.pitch, blured.ptr(), blured.pitch, dest.ptr(), dest.pitch, src.width, src.height, 1, sign * p.mindif, d.data());
+                });
+            double tp = best_time([&] {
+                for (int sign = -1; sign <= 1; sign += 2)
+                    s.DeScratch_pass(src.ptr(), src.pitch, blured.ptr(), blured.pitch, dest.ptr(), dest.pitch, src.width, src.height, 1, sign * s.mindif, s.asym);
+                });
+            printf("maxwidth=%-2d mark=%d MODE_ALL 1920x1080: reference %8.1f Mpix/s, plugin %8.1f Mpix/s\n", maxwidth, mark, mpix / tr, mpix / tp);
+            check(tp <= 2 * tr, "throughput maxwidth=" + std::to_string(maxwidth) + " mark=" + std::to_string(mark));
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && std::string(argv[1]) == "--bench") {
+        bench();
+    } else {
+        long good = test_kernels();
+        check(good > 0, "grid detects scratches");
+        test_filter();
+    }
+
+    printf("%ld checks, %d failures\n", checks, failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,333 @@
+/*
+Frozen copy of the scalar DeScratch kernels, used by descratch_test as the
+bit-exact reference for the plugin code. Do not optimize or change this file,
+any output difference against it is a regression.
+*/
+
+#pragma once
+
+#include <cstdlib>
+#include <algorithm>
+#include <vector>
+
+namespace reference {
+
+constexpr BYTE SD_NULL = 0;
+constexpr BYTE SD_EXTREM = 1;
+constexpr BYTE SD_TESTED = 2;
+constexpr BYTE SD_GOOD = 4;
+constexpr BYTE SD_REJECT = 8;
+
+constexpr int MODE_NONE = 0;
+constexpr int MODE_LOW = 1;
+constexpr int MODE_HIGH = 2;
+constexpr int MODE_ALL = 3;
+
+template<int maxwidth>
+static void  get_extrems_plane(const BYTE *VS_RESTRICT s, ptrdiff_t src_pitch, int row_size, int height, BYTE *VS_RESTRICT d, int mindif, int asym) {
+    constexpr int mw0 = (maxwidth + 1) / 2; // 7
+    constexpr int mwp1 = mw0 + 1; // 8
+    constexpr int mwm1 = mw0 - 1; // 6
+
+    if (mindif > 0) { // black (low value) scratches
+
+        for (int h = 0; h < height; h += 1) {
+            for (int row = 0; row < mwp1; row += 1)
+                d[row] = SD_NULL;
+            for (int row = mwp1; row < row_size - mwp1; row += 1) {    // middle rows
+                if ((s[row - mw0] - s[row] > mindif) && (s[row + mw0] - s[row] > mindif)
+                    && (abs(s[row - mwp1] - s[row + mwp1]) <= asym)
+                    && (s[row - mw0] - s[row - mwm1] + s[row + mw0] - s[row + mwm1] > s[row - mwp1] - s[row - mw0] + s[row + mwp1] - s[row + mw0]))
+                    d[row] = SD_EXTREM;  // sharp extremum found
+                else
+                    d[row] = SD_NULL;
+            }
+            for (int row = row_size - mwp1; row < row_size; row += 1)
+                d[row] = SD_NULL;
+
+            s += src_pitch;
+            d += row_size;
+        }
+
+    } else {    // white (high value) scratches
+
+        for (int h = 0; h < height; h += 1) {
+            for (int row = 0; row < mwp1; row += 1)
+                d[row] = SD_NULL;
+            for (int row = mwp1; row < row_size - mwp1; row += 1) {    // middle rows
+                if ((s[row - mw0] - s[row] < mindif) && (s[row + mw0] - s[row] < mindif)
+                    && (abs(s[row - mwp1] - s[row + mwp1]) <= asym)
+                    && (s[row - mw0] - s[row - mwm1] + s[row + mw0] - s[row + mwm1] < s[row - mwp1] - s[row - mw0] + s[row + mwp1] - s[row + mw0]))
+                    d[row] = SD_EXTREM;    // sharp extremum found
+                else
+                    d[row] = SD_NULL;
+            }
+            for (int row = row_size - mwp1; row < row_size; row += 1)
+                d[row] = SD_NULL;
+
+            s += src_pitch;
+            d += row_size;
+        }
+    }
+}
+
+// removewidth = minwidth - 2;
+template<int removewidth>
+static void  remove_min_extrems_plane(const BYTE *VS_RESTRICT s, ptrdiff_t src_pitch, int row_size, int height, BYTE *VS_RESTRICT d, int mindif, int asym) {
+    constexpr int rw0 = (removewidth + 1) / 2;
+    constexpr int rwp1 = rw0 + 1;
+    constexpr int rwm1 = rw0 - 1;
+
+    if (mindif > 0) { // black (low value) scratches
+
+        for (int h = 0; h < height; h += 1) {
+            for (int row = rwp1; row < row_size - rwp1; row += 1) {
+                if (d[row] == SD_EXTREM && (s[row - rw0] - s[row] > mindif) && (s[row + rw0] - s[row] > mindif)
+                    && (abs(s[row - rwp1] - s[row + rwp1]) <= asym)
+                    && (s[row - rw0] - s[row - rwm1] + s[row + rw0] - s[row + rwm1] > s[row - rwp1] - s[row - rw0] + s[row + rwp1] - s[row + rw0]))
+                    d[row] = SD_NULL;
+            }
+
+            s += src_pitch;
+            d += row_size;
+        }
+
+    } else {    // white (high value) scratches
+
+        for (int h = 0; h < height; h += 1) {
+            for (int row = rwp1; row < row_size - rwp1; row += 1) {
+                if (d[row] == SD_EXTREM && (s[row - rw0] - s[row] < mindif) && (s[row + rw0] - s[row] < mindif)
+                    && (abs(s[row - rwp1] - s[row + rwp1]) <= asym)
+                    && (s[row - rw0] - s[row - rwm1] + s[row + rw0] - s[row + rwm1] < s[row - rwp1] - s[row - rw0] + s[row + rwp1] - s[row + rw0]))
+                    d[row] = SD_NULL;
+            }
+
+            s += src_pitch;
+            d += row_size;
+        }
+    }
+}
+
+static void  close_gaps(BYTE *VS_RESTRICT d, int rows, int height, int maxgap) {
+    for (int h = maxgap; h < height; h++) {
+        for (int r = 0; r < rows; r++) {
+            int rh = r + h * rows;
+            if (d[rh] == SD_EXTREM) {       // found first point of candidate
+                for (int j = 1; j < maxgap; j++)
+                    d[rh - j * rows] = SD_EXTREM;    // expand to previous lines in range
+            }
+        }
+    }
+}
+
+// fixme, weird variable scoping but probably not worth the effort to improve further
+static void  test_scratches(BYTE *VS_RESTRICT d, int rows, int height, int maxwidth, int minlens, int maxlens, float maxangle) {
+    int rhcnew = 0;
+    int len = 0;
+    BYTE maskold, masknew;
+
+    for (int h = 0; h < height; h += 1) {
+        for (int r = 2; r < rows - 2; r += 1) {
+            int rh = r + h * rows;
+            if (d[rh] == SD_EXTREM) {       // found first point of candidate
+
+                for (int pass = 1; pass <= 2; pass += 1) {	// two passes
+
+                    if (pass == 1) {             // First pass - test
+                        maskold = SD_EXTREM;
+                        masknew = SD_TESTED;
+                    } else {                      // Second pass - decision
+                        maskold = SD_TESTED;  // repeat last cycle, but convert SD_TESTED to masknew
+                        if (len >= minlens && len <= maxlens) {
+                            masknew = SD_GOOD;
+                        }  // Good scratch found!
+                        else {
+                            masknew = SD_REJECT;
+                        }   // Bad scratch, reject
+                    }
+
+                    int rhc = rh + 1;             // centered to scratch for maxwidth=3
+
+                    for (len = 0; len < height - h; len += 1) {     // cycle along scratch
+                        int nrow = 0;  // number good points in row
+                        if (maxwidth >= 3) {
+                            if (d[rhc - 2] == maskold) {
+                                d[rhc - 2] = masknew;
+                                rhcnew = rhc - 2;
+                                nrow = nrow + 1;
+                            }
+                            if (d[rhc + 2] == maskold) {
+                                d[rhc + 2] = masknew;
+                                rhcnew = rhc + 2;
+                                nrow = nrow + 1;
+                            }
+                        }
+                        if (d[rhc - 1] == maskold) {
+                            d[rhc - 1] = masknew;
+                            rhcnew = rhc - 1;
+                            nrow = nrow + 1;
+                        }
+                        if (d[rhc + 1] == maskold) {
+                            d[rhc + 1] = masknew;
+                            rhcnew = rhc + 1;
+                            nrow = nrow + 1;
+                        }
+                        if (d[rhc] == maskold) {
+                            d[rhc] = masknew;
+                            rhcnew = rhc;
+                            nrow = nrow + 1;
+                        }
+                        // end of points tests, check result for row:
+                        if ((nrow > 0) && (maxwidth + len * maxangle / 57 > abs(rhcnew % rows - r)))// check gap, and angle
+                        {
+                            rhc = rhcnew + rows;           // new center for next row test
+                        } else {    // if no points or big angle, it is end of scratch, break  cycle
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+static void  mark_scratches_plane(BYTE *VS_RESTRICT dest_data, ptrdiff_t dest_pitch, ptrdiff_t row_size, int height, BYTE *VS_RESTRICT scratchdata, BYTE mask, BYTE value) {
+    for (int h = 0; h < height; h++) {
+        for (int row = 0; row < row_size; row++) {
+            if (scratchdata[row] == mask)
+                dest_data[row] = value;
+        }
+        dest_data += dest_pitch;
+        scratchdata += row_size;
+    }
+}
+
+static void remove_scratches_plane(const BYTE *VS_RESTRICT src_data, ptrdiff_t src_pitch, BYTE *VS_RESTRICT dest_data, ptrdiff_t dest_pitch,
+    const BYTE *VS_RESTRICT blured_data, ptrdiff_t blured_pitch, int row_size, int height, BYTE *VS_RESTRICT d,
+    int mindif1, int maxwidth, int keep100, int border) {
+    int rad = maxwidth / 2;  // 3/2=1
+    int keep256 = (keep100 * 256) / 100; // to norm 256
+    int div2rad2 = (256 * 256) / (2 * rad + 2); // to div by 2*rad+2, replace division by mult and shift
+
+    for (int h = 0; h < height; h += 1) {
+        int left = 0; // v.0.9.1
+        for (int row = rad + border + 2; row < row_size - rad - border - 2; row += 1) {
+
+            if (!!(d[row] & SD_GOOD) && !(d[row - 1] & SD_GOOD))         // the scratch left
+                left = row;                                           // memo
+            if (left != 0 && !!(d[row] & SD_GOOD) && !(d[row + 1] & SD_GOOD)) {        // the scratch right
+                int rowc = (left + row) / 2;                                // the scratch center
+
+                for (int i = -rad; i <= rad; i += 1) {          // in scratch
+                    int newdata1 = ((keep256 * (src_data[rowc + i] + blured_data[rowc - rad - border - 1] - blured_data[rowc + i])) + (256 - keep256) * src_data[rowc - rad - border - 1]) / 256;
+                    int newdata2 = ((keep256 * (src_data[rowc + i] + blured_data[rowc + rad + border + 1] - blured_data[rowc + i])) + (256 - keep256) * src_data[rowc + rad + border + 1]) / 256;
+                    int newdata = ((newdata1 * (rad - i + 1) + newdata2 * (rad + i + 1)) * div2rad2) / (256 * 256); // weighted left and right
+                    dest_data[rowc + i] = std::min(255, std::max(0, newdata));
+                }
+                for (int i = -rad - border; i < -rad; i += 1) {         // at left border
+                    int newdata = src_data[rowc + i] + blured_data[rowc - rad - border - 1] - blured_data[rowc + i];
+                    newdata = (keep256 * newdata + (256 - keep256) * src_data[rowc - rad - border - 1]) / 256;
+                    dest_data[rowc + i] = std::min(255, std::max(0, newdata));
+                }
+                for (int i = rad + 1; i <= rad + border; i += 1) {         // at right border
+                    int newdata = src_data[rowc + i] + blured_data[rowc + rad + border + 1] - blured_data[rowc + i];
+                    newdata = (keep256 * newdata + (256 - keep256) * src_data[rowc + rad + border + 1]) / 256;
+                    dest_data[rowc + i] = std::min(255, std::max(0, newdata));
+                }
+                left = 0;
+            }
+        }
+        src_data += src_pitch;
+        dest_data += dest_pitch;
+        blured_data += blured_pitch;
+        d += row_size;
+    }
+
+}
+
+struct Params {
+    int mindif;
+    int asym;
+    int maxgap;
+    int maxwidth;
+    int minlen;
+    int maxlen;
+    float maxangle;
+    int keep;
+    int border;
+    bool mark;
+    int minwidth;
+};
+
+// extrems search, thin extrems removal and gaps closing, d gets the candidate map
+static void find_candidates(const Params &p, const BYTE *bluredp, ptrdiff_t blured_pitch, int row_sizep, int heightp, int hscale, int mindifp, BYTE *d) {
+    switch (p.maxwidth) {
+    case 1: get_extrems_plane<1>(bluredp, blured_pitch, row_sizep, heightp, d, mindifp, p.asym); break;
+    case 3: get_extrems_plane<3>(bluredp, blured_pitch, row_sizep, heightp, d, mindifp, p.asym); break;
+    case 5: get_extrems_plane<5>(bluredp, blured_pitch, row_sizep, heightp, d, mindifp, p.asym); break;
+    case 7: get_extrems_plane<7>(bluredp, blured_pitch, row_sizep, heightp, d, mindifp, p.asym); break;
+    case 9: get_extrems_plane<9>(bluredp, blured_pitch, row_sizep, heightp, d, mindifp, p.asym); break;
+    case 11: get_extrems_plane<11>(bluredp, blured_pitch, row_sizep, heightp, d, mindifp, p.asym); break;
+    case 13: get_extrems_plane<13>(bluredp, blured_pitch, row_sizep, heightp, d, mindifp, p.asym); break;
+    case 15: get_extrems_plane<15>(bluredp, blured_pitch, row_sizep, heightp, d, mindifp, p.asym); break;
+    }
+
+    switch (p.minwidth - 2) {
+    case 1: remove_min_extrems_plane<1>(bluredp, blured_pitch, row_sizep, heightp, d, mindifp, p.asym); break;
+    case 3: remove_min_extrems_plane<3>(bluredp, blured_pitch, row_sizep, heightp, d, mindifp, p.asym); break;
+    case 5: remove_min_extrems_plane<5>(bluredp, blured_pitch, row_sizep, heightp, d, mindifp, p.asym); break;
+    case 7: remove_min_extrems_plane<7>(bluredp, blured_pitch, row_sizep, heightp, d, mindifp, p.asym); break;
+    case 9: remove_min_extrems_plane<9>(bluredp, blured_pitch, row_sizep, heightp, d, mindifp, p.asym); break;
+    case 11: remove_min_extrems_plane<11>(bluredp, blured_pitch, row_sizep, heightp, d, mindifp, p.asym); break;
+    case 13: remove_min_extrems_plane<13>(bluredp, blured_pitch, row_sizep, heightp, d, mindifp, p.asym); break;
+    }
+    close_gaps(d, row_sizep, heightp, p.maxgap / hscale);
+}
+
+// one polarity pass over a plane, d is left with the final scratch map
+static void pass(const Params &p, const BYTE *srcp, ptrdiff_t src_pitch, const BYTE *bluredp, ptrdiff_t blured_pitch,
+    BYTE *destp, ptrdiff_t dest_pitch, int row_sizep, int heightp, int hscale, int mindifp, BYTE *d) {
+
+    if (row_sizep < p.maxwidth + 3)
+        return;
+
+    find_candidates(p, bluredp, blured_pitch, row_sizep, heightp, hscale, mindifp, d);
+    test_scratches(d, row_sizep, heightp, p.maxwidth, p.minlen / hscale, p.maxlen / hscale, p.maxangle);
+
+    if (p.mark) {
+        mark_scratches_plane(destp, dest_pitch, row_sizep, heightp, d, SD_GOOD, (mindifp > 0) ? 0 : 255);
+        mark_scratches_plane(destp, dest_pitch, row_sizep, heightp, d, SD_REJECT, 127);
+    } else {
+        remove_scratches_plane(srcp, src_pitch, destp, dest_pitch, bluredp, blured_pitch,
+            row_sizep, heightp, d, mindifp, p.maxwidth, p.keep, p.border);
+    }
+}
+
+static void copy_plane(BYTE *dstp, ptrdiff_t dst_pitch, const BYTE *srcp, ptrdiff_t src_pitch, int row_size, int height) {
+    for (int h = 0; h < height; h++)
+        std::copy(srcp + h * src_pitch, srcp + h * src_pitch + row_size, dstp + h * dst_pitch);
+}
+
+// whole plane processing as done by the filters, wleft and wright already normalized
+static void process_plane(const Params &p, const BYTE *srcp, ptrdiff_t src_pitch, const BYTE *bluredp, ptrdiff_t blured_pitch,
+    BYTE *destp, ptrdiff_t dest_pitch, int row_size, int heightp, int width, int height, int mode, int mindif, int wleft, int wright) {
+    int wleftp = wleft * row_size / width;
+    int wrightp = wright * row_size / width;
+    std::vector<BYTE> d(row_size * heightp);
+
+    if (mode == MODE_ALL) {
+        std::vector<BYTE> buf(row_size * heightp);
+        copy_plane(buf.data(), row_size, srcp, src_pitch, row_size, heightp);
+        pass(p, srcp + wleftp, src_pitch, bluredp + wleftp, blured_pitch, buf.data() + wleftp, row_size, wrightp - wleftp, heightp, height / heightp, mindif, d.data());
+        copy_plane(destp, dest_pitch, buf.data(), row_size, row_size, heightp);
+        pass(p, buf.data() + wleftp, row_size, bluredp + wleftp, blured_pitch, destp + wleftp, dest_pitch, wrightp - wleftp, heightp, height / heightp, -mindif, d.data());
+    } else {
+        copy_plane(destp, dest_pitch, srcp, src_pitch, row_size, heightp);
+        if (mode == MODE_LOW || mode == MODE_HIGH) {
+            int sign = (mode == MODE_LOW) ? 1 : -1;
+            pass(p, srcp + wleftp, src_pitch, bluredp + wleftp, blured_pitch, destp + wleftp, dest_pitch, wrightp - wleftp, heightp, height / heightp, sign * mindif, d.data());
+        }
+    }
+}
+
+}